@@ -0,0 +1,100 @@
+/*
+  Touch processing for the XPT2046 touch controller.
+
+  Raw samples are de-spiked with a median-of-3 window and smoothed with a
+  fixed-point IIR filter, then mapped to screen pixels through a 3-point
+  affine calibration matrix that is stored on SPIFFS.
+
+  The XPT2046 library caches a conversion for a few milliseconds. On the
+  frame a press starts, update() takes two extra conversions spaced just
+  past that cache to fill the median window (a one-off stall of about
+  10 ms); after that it takes one conversion per call.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>             // Hardware-specific TFT library
+#include <XPT2046_Touchscreen.h>  // Touchscreen library
+
+// Calibration record location on SPIFFS.
+#define TOUCH_CAL_FILE "/touch_cal.bin"
+
+// Filter tuning. The filtered coordinate is kept with TOUCH_FILTER_FRAC_BITS
+// fractional bits; each sample moves it by 1 / 2^TOUCH_IIR_SHIFT of the error.
+#define TOUCH_FILTER_FRAC_BITS 4
+#define TOUCH_IIR_SHIFT        1
+// A press is "stable" once the median window is full and this many
+// consecutive medians land within TOUCH_STABLE_DELTA raw units of the
+// filtered coordinate.
+#define TOUCH_STABLE_DELTA     24
+#define TOUCH_STABLE_COUNT     2
+
+// Calibration matrix coefficients are stored in Q16 fixed point.
+#define TOUCH_CAL_FRAC_BITS 16
+
+struct TouchPoint {
+  int16_t x;
+  int16_t y;
+};
+
+class TouchProcessor {
+public:
+  TouchProcessor(TFT_eSPI &tft, XPT2046_Touchscreen &ts);
+
+  // Mount SPIFFS and load the stored calibration. The on-screen calibration
+  // runs when no matching record exists or when forceCalibration is set.
+  // Call after tft.setRotation() and ts.begin().
+  void begin(bool forceCalibration = false);
+
+  // Ask the user to touch three calibration crosses plus a centre check cross
+  // (four touches in total), then compute, verify and save the matrix.
+  void calibrate();
+
+  // Sample the touch controller and update the filter. Call once per frame.
+  // Returns true while the screen is pressed.
+  bool update();
+
+  bool pressed() const { return isPressed; }
+  // True once the filtered coordinate has settled for the current press.
+  bool stable() const { return stableCount >= TOUCH_STABLE_COUNT; }
+  // True only on the update() where the current press first became stable.
+  // A press released before that is reported on release only if its median
+  // window filled and the last median was within TOUCH_STABLE_DELTA of the
+  // filtered point; noisier presses are dropped. Use this for hit-testing
+  // so each press is reported at most once.
+  bool tapped() const { return isTapped; }
+
+  // Filtered, calibrated position in screen pixels. Remains valid on the
+  // update() that reports a tap on release.
+  TouchPoint point() const;
+
+private:
+  struct Calibration {
+    int32_t coeff[6];  // x = c0*rx + c1*ry + c2, y = c3*rx + c4*ry + c5 (Q16)
+  };
+
+  void resetFilter();
+  bool readSample();
+  void release();
+  TouchPoint mapRaw(int32_t rawX, int32_t rawY) const;
+  bool loadCalibration();
+  bool saveCalibration() const;
+  void sampleTarget(int32_t &rawX, int32_t &rawY);
+  void calibrationFailed();
+  void drawTarget(int16_t x, int16_t y, uint16_t color);
+
+  TFT_eSPI &tft;
+  XPT2046_Touchscreen &ts;
+
+  Calibration cal;
+
+  int16_t windowX[3], windowY[3];  // Median-of-3 sample window (raw units)
+  uint8_t windowPos;
+  uint8_t windowFill;              // Real samples in the window this press
+  int32_t filtX, filtY;            // IIR state (raw units, fixed point)
+  uint8_t stableCount;
+  bool isPressed;
+  bool isTapped;
+  bool tapReported;                // Tap already reported for this press
+};
@@ -10,6 +10,7 @@
 #include <SPI.h>
 #include <TFT_eSPI.h>         // Hardware-specific TFT library
 #include <XPT2046_Touchscreen.h>  // Touchscreen library
+#include "touch_processing.h"     // Filtered, calibrated touch input
 
 // Optionally define colors if not already defined by TFT_eSPI
 #ifndef TFT_BLACK
@@ -26,6 +27,7 @@
 // Instantiate display and touch objects
 TFT_eSPI tft = TFT_eSPI();
 XPT2046_Touchscreen ts(TOUCH_CS, XPT2046_IRQ);
+TouchProcessor touch(tft, ts);
 
 // Global variables for cube and touch handling
 int16_t h, w;
@@ -87,9 +89,10 @@ void setup() {
   tft.setRotation(1);
   tft.fillScreen(TFT_BLACK);
 
-  // Initialize touchscreen
+  // Initialize touchscreen. Hold the screen during reset to recalibrate.
   ts.begin();
-  // Optionally, adjust TS calibration here if needed.
+  ts.setRotation(1);
+  touch.begin(ts.touched());
 
   cube();  // Build the cube geometry
 
@@ -103,10 +106,9 @@ void setup() {
 
 void loop() {
   // If the screen is touched, adjust rotation angles based on drag
-  if (ts.touched()) {
-    // Get touch coordinates. (Depending on the library, you may need to call getPoint())
-    TS_Point p = ts.getPoint();
-    // The raw touch coordinates might need mapping; adjust factor if necessary.
+  if (touch.update()) {
+    // Filtered touch position in screen pixels.
+    TouchPoint p = touch.point();
     int touchX = p.x;
     int touchY = p.y;
 
@@ -120,9 +122,9 @@ void loop() {
       int dx = touchX - lastTouchX;
       int dy = touchY - lastTouchY;
 
-      // Adjust sensitivity as needed (here 0.5 is an arbitrary factor)
-      Xan += dx * 0.5;
-      Yan += dy * 0.5;
+      // One degree of rotation per pixel dragged.
+      Xan += dx;
+      Yan += dy;
 
       lastTouchX = touchX;
       lastTouchY = touchY;
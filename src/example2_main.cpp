@@ -16,6 +16,7 @@
 #include <SPI.h>
 #include <TFT_eSPI.h>           // Hardware-specific TFT library
 #include <XPT2046_Touchscreen.h>  // Touchscreen library
+#include "touch_processing.h"     // Filtered, calibrated touch input
 
 // Define touch controller pins (adjust as needed)
 #define TOUCH_CS 16
@@ -25,14 +26,6 @@
 // Constants & Global Variables
 // -------------------------
 
-// Calibration constants – adjust these based on your touchscreen’s raw coordinate range.
-#define TS_MINX 400
-#define TS_MAXX 1200
-#define TS_MINY 300
-#define TS_MAXY 3600
-
-
-
 // Use a scale factor to make the meter as wide as possible in a 320–pixel–wide column.
 // With meterScale = 1.3333, the background width becomes 1.3333 * 239 ≈ 318 pixels.
 const float meterScale = 1.3333f;
@@ -62,6 +55,7 @@ const int rightColumnWidth = SCREEN_WIDTH - leftColumnWidth;  // Buttons occupy
 // Instantiate TFT and touchscreen objects
 TFT_eSPI tft = TFT_eSPI();
 XPT2046_Touchscreen ts(TOUCH_CS, XPT2046_IRQ);
+TouchProcessor touch(tft, ts);
 
 // For test purposes, a variable to drive sine–wave test data for the meters.
 static int d = 0;
@@ -95,6 +89,8 @@ void setup() {
 
   ts.begin();
   ts.setRotation(1);  // Set touch rotation if needed
+  // Load the touch calibration from SPIFFS. Hold the screen during reset to recalibrate.
+  touch.begin(ts.touched());
 
   // Initialize each meter's state and draw its background in its vertical slot.
   for (int i = 0; i < NUM_METERS; i++) {
@@ -309,29 +305,17 @@ void drawButtons() {
     }
   }
 
-// Calibration constants – adjust these based on your touchscreen’s raw coordinate range.
-#define TS_MINX 400
-#define TS_MAXX 1200
-#define TS_MINY 300
-#define TS_MAXY 3600
-
 // -------------------------
 // Check for touches in the right column and update button states.
 // -------------------------
 void checkButtons() {
-  if (ts.touched()) {
-    TS_Point p = ts.getPoint();
-
-    // Print raw touch coordinates.
-    Serial.print("Raw Touch coordinates: x = ");
-    Serial.print(p.x);
-    Serial.print(", y = ");
-    Serial.println(p.y);
-
-    // Map raw touch coordinates to display coordinates.
-    int mappedX = map(p.x, TS_MINX, TS_MAXX, 0, SCREEN_WIDTH);
-    // Invert Y axis mapping so that higher raw values map to lower Y coordinates.
-    int mappedY = map(p.y, TS_MINY, TS_MAXY, SCREEN_HEIGHT, 0);
+  touch.update();
+  // Act once per press, as soon as the filtered position has settled.
+  if (touch.tapped()) {
+    // Calibrated touch position in display coordinates.
+    TouchPoint p = touch.point();
+    int mappedX = p.x;
+    int mappedY = p.y;
 
     Serial.print("Mapped Touch coordinates: x = ");
     Serial.print(mappedX);
@@ -370,6 +354,5 @@ void checkButtons() {
         }
       }
     }
-    delay(100);
   }
 }
@@ -0,0 +1,352 @@
+/*
+  Touch processing for the XPT2046 touch controller.
+  See touch_processing.h for an overview.
+*/
+
+#include "touch_processing.h"
+
+#include <FS.h>
+#include <SPIFFS.h>
+
+// The XPT2046 library reuses its last conversion for 3 ms; wait slightly
+// longer between back-to-back samples so each one is a fresh reading.
+#define TOUCH_SAMPLE_INTERVAL_MS 5
+// Stable samples averaged into each calibration target.
+#define TOUCH_CAL_SETTLE_SAMPLES 8
+// Smallest acceptable determinant (raw units squared) for the three targets.
+// This needs roughly an eighth of the 12-bit range between them on both axes.
+#define TOUCH_CAL_MIN_DETERMINANT (512.0 * 512.0)
+// Largest error (pixels) allowed on the verification target.
+#define TOUCH_CAL_VERIFY_TOLERANCE 12
+// Full scale of the 12-bit XPT2046 conversions.
+#define TOUCH_RAW_RANGE 4096
+
+// Stored calibration record. Rotation and resolution are kept so a record
+// taken in a different screen orientation is not reused by mistake.
+#define TOUCH_CAL_MAGIC   0x54434C42  // "TCLB"
+#define TOUCH_CAL_VERSION 1
+
+struct CalibrationRecord {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t width;
+  uint16_t height;
+  uint8_t rotation;
+  uint8_t reserved;
+  int32_t coeff[6];
+};
+
+// Median of three values using two compare-and-swap steps.
+static inline int16_t median3(int16_t a, int16_t b, int16_t c) {
+  if (a > b) { int16_t t = a; a = b; b = t; }
+  if (b > c) b = c;
+  return (a > b) ? a : b;
+}
+
+// The screen must map onto at most the full raw range, so the matrix's 2x2
+// part has a determinant of at least (w * h) / TOUCH_RAW_RANGE^2. Anything
+// far below that (e.g. all zeros from a partial write) is unusable.
+static bool plausibleScale(const int32_t coeff[6], int16_t w, int16_t h) {
+  int64_t det = (int64_t)coeff[0] * coeff[4] - (int64_t)coeff[1] * coeff[3];
+  double scale = (double)det / ((double)(1L << TOUCH_CAL_FRAC_BITS) * (1L << TOUCH_CAL_FRAC_BITS));
+  double minScale = (double)w * h / ((double)TOUCH_RAW_RANGE * TOUCH_RAW_RANGE) / 2;
+  return fabs(scale) >= minScale;
+}
+
+TouchProcessor::TouchProcessor(TFT_eSPI &tft, XPT2046_Touchscreen &ts)
+    : tft(tft), ts(ts), cal{} {
+  resetFilter();
+}
+
+void TouchProcessor::begin(bool forceCalibration) {
+  // Format on first use so the calibration can always be saved.
+  if (!SPIFFS.begin(true)) {
+    log_w("SPIFFS mount failed, touch calibration will not be saved");
+  }
+
+  if (forceCalibration || !loadCalibration()) {
+    calibrate();
+  }
+  resetFilter();
+}
+
+void TouchProcessor::resetFilter() {
+  for (int i = 0; i < 3; i++) {
+    windowX[i] = 0;
+    windowY[i] = 0;
+  }
+  windowPos = 0;
+  windowFill = 0;
+  filtX = 0;
+  filtY = 0;
+  stableCount = 0;
+  isPressed = false;
+  isTapped = false;
+  tapReported = false;
+}
+
+// Take one conversion and feed it through the filter.
+// Returns false when the screen is not touched.
+bool TouchProcessor::readSample() {
+  // touched() performs the conversion; getPoint() below reuses it.
+  if (!ts.touched()) return false;
+  TS_Point p = ts.getPoint();
+
+  if (!isPressed) {
+    resetFilter();
+    isPressed = true;
+  }
+
+  windowX[windowPos] = p.x;
+  windowY[windowPos] = p.y;
+  windowPos = (windowPos + 1) % 3;
+
+  if (windowFill < 3) {
+    // Until the window holds three real samples there is no meaningful
+    // median, so track their mean and do not judge stability yet.
+    windowFill++;
+    int32_t sumX = 0, sumY = 0;
+    for (int i = 0; i < windowFill; i++) {
+      sumX += windowX[i];
+      sumY += windowY[i];
+    }
+    filtX = (sumX << TOUCH_FILTER_FRAC_BITS) / windowFill;
+    filtY = (sumY << TOUCH_FILTER_FRAC_BITS) / windowFill;
+    return true;
+  }
+
+  // Median rejects single-sample spikes, the IIR smooths what remains.
+  int32_t mx = (int32_t)median3(windowX[0], windowX[1], windowX[2]) << TOUCH_FILTER_FRAC_BITS;
+  int32_t my = (int32_t)median3(windowY[0], windowY[1], windowY[2]) << TOUCH_FILTER_FRAC_BITS;
+  int32_t ex = mx - filtX;
+  int32_t ey = my - filtY;
+  filtX += ex >> TOUCH_IIR_SHIFT;
+  filtY += ey >> TOUCH_IIR_SHIFT;
+
+  const int32_t stableDelta = (int32_t)TOUCH_STABLE_DELTA << TOUCH_FILTER_FRAC_BITS;
+  if (abs(ex) <= stableDelta && abs(ey) <= stableDelta) {
+    if (stableCount < 255) stableCount++;
+  } else {
+    stableCount = 0;
+  }
+  return true;
+}
+
+// End the current press. A short press that never reached stable() is still
+// reported as a tap if its median window filled and the last median agreed
+// with the filtered point; anything noisier is dropped.
+void TouchProcessor::release() {
+  if (isPressed && !tapReported && windowFill == 3 && stableCount > 0) {
+    isTapped = true;
+    tapReported = true;
+  }
+  isPressed = false;
+  stableCount = 0;
+}
+
+bool TouchProcessor::update() {
+  isTapped = false;
+
+  bool newPress = !isPressed;
+  if (!readSample()) {
+    release();
+    return false;
+  }
+
+  // On the frame a press starts, fill the median window now; stability then
+  // builds over the following frames at one conversion each.
+  while (newPress && windowFill < 3) {
+    delay(TOUCH_SAMPLE_INTERVAL_MS);
+    if (!readSample()) {
+      release();
+      return false;
+    }
+  }
+
+  if (stable() && !tapReported) {
+    isTapped = true;
+    tapReported = true;
+  }
+  return true;
+}
+
+TouchPoint TouchProcessor::point() const {
+  return mapRaw(filtX, filtY);
+}
+
+// Map a raw position (with TOUCH_FILTER_FRAC_BITS fraction bits) to pixels.
+TouchPoint TouchProcessor::mapRaw(int32_t rawX, int32_t rawY) const {
+  // Coefficients are Q16 and the raw position carries its own fraction bits,
+  // so the product is shifted back by both.
+  const int shift = TOUCH_CAL_FRAC_BITS + TOUCH_FILTER_FRAC_BITS;
+  const int64_t round = (int64_t)1 << (shift - 1);
+  int64_t x = (int64_t)cal.coeff[0] * rawX + (int64_t)cal.coeff[1] * rawY +
+              ((int64_t)cal.coeff[2] << TOUCH_FILTER_FRAC_BITS) + round;
+  int64_t y = (int64_t)cal.coeff[3] * rawX + (int64_t)cal.coeff[4] * rawY +
+              ((int64_t)cal.coeff[5] << TOUCH_FILTER_FRAC_BITS) + round;
+
+  TouchPoint pt;
+  pt.x = constrain((int32_t)(x >> shift), 0, tft.width() - 1);
+  pt.y = constrain((int32_t)(y >> shift), 0, tft.height() - 1);
+  return pt;
+}
+
+// -------------------------
+// Calibration
+// -------------------------
+
+void TouchProcessor::calibrate() {
+  const int16_t w = tft.width();
+  const int16_t h = tft.height();
+
+  // Three well-separated, non-collinear targets plus a fourth in the middle
+  // that checks the result before it is saved.
+  const int16_t tx[4] = { (int16_t)(w / 10), (int16_t)(w - w / 10), (int16_t)(w / 2), (int16_t)(w / 2) };
+  const int16_t ty[4] = { (int16_t)(h / 10), (int16_t)(h / 2), (int16_t)(h - h / 10), (int16_t)(h / 2) };
+
+  while (true) {
+    tft.fillScreen(TFT_BLACK);
+    tft.setTextColor(TFT_WHITE, TFT_BLACK);
+    tft.drawCentreString("Touch each cross to calibrate", w / 2, h / 4 - 8, 2);
+    tft.drawCentreString("Hold the screen during reset to recalibrate", w / 2, h / 4 + 12, 2);
+
+    int32_t rx[4], ry[4];
+    for (int i = 0; i < 4; i++) {
+      drawTarget(tx[i], ty[i], TFT_WHITE);
+      sampleTarget(rx[i], ry[i]);
+      drawTarget(tx[i], ty[i], TFT_BLACK);
+      log_d("Target (%d, %d) -> raw (%d, %d)", tx[i], ty[i],
+            (int)(rx[i] >> TOUCH_FILTER_FRAC_BITS), (int)(ry[i] >> TOUCH_FILTER_FRAC_BITS));
+    }
+
+    // Solve screen = A * raw + B for both axes (Cramer's rule, relative to
+    // the third point). Done once, so floating point is fine here.
+    const double scale = 1 << TOUCH_FILTER_FRAC_BITS;
+    double u = (rx[0] - rx[2]) / scale, v = (ry[0] - ry[2]) / scale;
+    double p = (rx[1] - rx[2]) / scale, q = (ry[1] - ry[2]) / scale;
+    double det = u * q - p * v;
+    if (fabs(det) < TOUCH_CAL_MIN_DETERMINANT) {
+      log_w("Touch calibration points too close together, retrying");
+      calibrationFailed();
+      continue;
+    }
+
+    Calibration next;
+    const int16_t *target[2] = { tx, ty };
+    for (int axis = 0; axis < 2; axis++) {
+      double s0 = target[axis][0] - target[axis][2];
+      double s1 = target[axis][1] - target[axis][2];
+      double a = (s0 * q - s1 * v) / det;
+      double b = (u * s1 - s0 * p) / det;
+      double c = target[axis][2] - a * (rx[2] / scale) - b * (ry[2] / scale);
+      next.coeff[axis * 3 + 0] = lround(a * (1L << TOUCH_CAL_FRAC_BITS));
+      next.coeff[axis * 3 + 1] = lround(b * (1L << TOUCH_CAL_FRAC_BITS));
+      next.coeff[axis * 3 + 2] = lround(c * (1L << TOUCH_CAL_FRAC_BITS));
+    }
+
+    if (!plausibleScale(next.coeff, w, h)) {
+      log_w("Touch calibration scale implausible, retrying");
+      calibrationFailed();
+      continue;
+    }
+
+    // The verification target must land where it was drawn.
+    Calibration previous = cal;
+    cal = next;
+    TouchPoint check = mapRaw(rx[3], ry[3]);
+    if (abs(check.x - tx[3]) > TOUCH_CAL_VERIFY_TOLERANCE ||
+        abs(check.y - ty[3]) > TOUCH_CAL_VERIFY_TOLERANCE) {
+      log_w("Touch calibration check missed by (%d, %d), retrying",
+            check.x - tx[3], check.y - ty[3]);
+      cal = previous;
+      calibrationFailed();
+      continue;
+    }
+    break;
+  }
+
+  if (saveCalibration()) {
+    log_i("Touch calibration saved to %s", TOUCH_CAL_FILE);
+  } else {
+    log_w("Could not save touch calibration");
+  }
+  tft.fillScreen(TFT_BLACK);
+}
+
+void TouchProcessor::calibrationFailed() {
+  tft.fillScreen(TFT_BLACK);
+  tft.setTextColor(TFT_WHITE, TFT_BLACK);
+  tft.drawCentreString("Calibration failed, try again", tft.width() / 2, tft.height() / 2 - 8, 2);
+  delay(1500);
+}
+
+// Wait for a settled press and return its filtered raw position.
+void TouchProcessor::sampleTarget(int32_t &rawX, int32_t &rawY) {
+  resetFilter();
+
+  // Make sure the previous target has been released.
+  while (update()) delay(TOUCH_SAMPLE_INTERVAL_MS);
+
+  int64_t sumX = 0, sumY = 0;
+  int settled = 0;
+  while (settled < TOUCH_CAL_SETTLE_SAMPLES) {
+    delay(TOUCH_SAMPLE_INTERVAL_MS);
+    if (!update() || !stable()) {
+      // Lifted or not settled: only average an unbroken run of stable samples.
+      sumX = sumY = 0;
+      settled = 0;
+      continue;
+    }
+    sumX += filtX;
+    sumY += filtY;
+    settled++;
+  }
+  rawX = sumX / TOUCH_CAL_SETTLE_SAMPLES;
+  rawY = sumY / TOUCH_CAL_SETTLE_SAMPLES;
+
+  while (update()) delay(TOUCH_SAMPLE_INTERVAL_MS);
+  resetFilter();
+}
+
+void TouchProcessor::drawTarget(int16_t x, int16_t y, uint16_t color) {
+  tft.drawFastHLine(x - 10, y, 21, color);
+  tft.drawFastVLine(x, y - 10, 21, color);
+  tft.drawCircle(x, y, 5, color);
+}
+
+bool TouchProcessor::loadCalibration() {
+  File f = SPIFFS.open(TOUCH_CAL_FILE, FILE_READ);
+  if (!f) return false;
+
+  CalibrationRecord rec;
+  bool ok = f.read((uint8_t *)&rec, sizeof(rec)) == sizeof(rec);
+  f.close();
+
+  ok = ok && rec.magic == TOUCH_CAL_MAGIC && rec.version == TOUCH_CAL_VERSION &&
+       rec.width == tft.width() && rec.height == tft.height() &&
+       rec.rotation == tft.getRotation() &&
+       plausibleScale(rec.coeff, tft.width(), tft.height());
+  if (!ok) {
+    log_i("No matching touch calibration in %s", TOUCH_CAL_FILE);
+    return false;
+  }
+
+  memcpy(cal.coeff, rec.coeff, sizeof(cal.coeff));
+  return true;
+}
+
+bool TouchProcessor::saveCalibration() const {
+  CalibrationRecord rec = {};
+  rec.magic = TOUCH_CAL_MAGIC;
+  rec.version = TOUCH_CAL_VERSION;
+  rec.width = tft.width();
+  rec.height = tft.height();
+  rec.rotation = tft.getRotation();
+  memcpy(rec.coeff, cal.coeff, sizeof(rec.coeff));
+
+  File f = SPIFFS.open(TOUCH_CAL_FILE, FILE_WRITE);
+  if (!f) return false;
+  bool ok = f.write((const uint8_t *)&rec, sizeof(rec)) == sizeof(rec);
+  f.close();
+  return ok;
+}